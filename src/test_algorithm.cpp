@@ -1,5 +1,6 @@
 #include <array>
 #include <vector>
+#include <memory>
 #include <limits>
 #include <iterator>
 #include <iostream>
@@ -144,6 +145,392 @@ RT_TEST(test_min_element)
   std::cout << "test_min_element ok" << std::endl;
 }
 
+RT_TEST(test_branchless_lower_bound)
+{
+  for (auto n : {0, 1, 2, 3, 7, 8, 100, 1000}) {
+    auto data = rt::make_rand_data(n, 0, n / 2, 1);
+    std::sort(std::begin(data), std::end(data));
+    for (auto k = -1; k <= n / 2 + 1; ++k) {
+      auto a = std::lower_bound(std::begin(data), std::end(data), k);
+      auto b = rt::branchless_lower_bound(std::begin(data), std::end(data), k);
+      RT_CHECK(a == b)
+    }
+  }
+}
+
+RT_TEST(test_eytzinger)
+{
+  for (auto n : {0, 1, 2, 3, 7, 8, 100, 1000}) {
+    auto data = rt::make_rand_data(n, 0, n / 2, 1);
+    std::sort(std::begin(data), std::end(data));
+    auto v = rt::make_eytzinger(std::begin(data), std::end(data));
+    RT_CHECK(v.size() == data.size() + 1)
+
+    // The in-order of the implicit tree is the sorted range.
+    std::vector<int> in;
+    std::vector<std::size_t> s;
+    for (std::size_t k = 1; k < v.size() || !s.empty();) {
+      if (k < v.size()) {
+        s.push_back(k);
+        k = 2 * k;
+      } else {
+        k = s.back();
+        s.pop_back();
+        in.push_back(v[k]);
+        k = 2 * k + 1;
+      }
+    }
+    RT_CHECK(in == data)
+
+    for (auto k = -1; k <= n / 2 + 1; ++k) {
+      auto a = std::lower_bound(std::begin(data), std::end(data), k);
+      auto i = rt::eytzinger_lower_bound(v, k);
+      if (a == std::end(data)) {
+        RT_CHECK(i == 0)
+      } else {
+        RT_CHECK(i != 0 && v[i] == *a)
+      }
+    }
+  }
+}
+
+RT_TEST(test_simd_search)
+{
+  using rt::simd_isa;
+  std::vector<simd_isa> isas {simd_isa::scalar};
+  if (rt::simd_best() != simd_isa::scalar)
+    isas.push_back(simd_isa::sse2);
+  if (rt::simd_best() == simd_isa::avx2)
+    isas.push_back(simd_isa::avx2);
+
+  for (auto isa : isas) {
+    for (auto n : {0, 1, 3, 4, 5, 8, 9, 16, 17, 100, 300, 1000}) {
+      auto data = rt::make_rand_data(n, 0, n / 2, 1);
+      auto b = data.data();
+      auto e = b + n;
+      for (auto k = -1; k <= n / 2 + 1; ++k)
+        RT_CHECK(rt::simd_find(b, e, k, isa) == std::find(b, e, k))
+
+      std::sort(b, e);
+      for (auto k = -1; k <= n / 2 + 1; ++k) {
+        auto p = rt::kary_lower_bound(b, e, k, isa);
+        RT_CHECK(p == std::lower_bound(b, e, k))
+      }
+    }
+  }
+}
+
+template <int G>
+bool search_many_tester(int n, bool sorted)
+{
+  auto data = rt::make_rand_data(n, 0, n, 1);
+  std::sort(std::begin(data), std::end(data));
+  auto queries = rt::make_rand_data(3 * n + 5, -1, n + 1, 1);
+  if (sorted)
+    std::sort(std::begin(queries), std::end(queries));
+
+  auto b = std::begin(data);
+  auto e = std::end(data);
+  std::vector<std::vector<int>::iterator> lb;
+  rt::batch_stats stats;
+  rt::lower_bound_many<G>( b, e, std::begin(queries), std::end(queries)
+                         , std::back_inserter(lb), &stats);
+  if (lb.size() != queries.size() || stats.queries != queries.size())
+    return false;
+  if (stats.sweep != std::is_sorted(std::begin(queries), std::end(queries)))
+    return false;
+
+  std::vector<bool> found;
+  rt::binary_search_many<G>( b, e, std::begin(queries), std::end(queries)
+                           , std::back_inserter(found));
+  for (std::size_t i = 0; i < queries.size(); ++i) {
+    if (lb[i] != std::lower_bound(b, e, queries[i]))
+      return false;
+    if (found[i] != std::binary_search(b, e, queries[i]))
+      return false;
+  }
+  return true;
+}
+
+RT_TEST(test_search_many)
+{
+  for (auto n : {0, 1, 2, 7, 100, 1000}) {
+    RT_CHECK(search_many_tester<1>(n, false))
+    RT_CHECK(search_many_tester<16>(n, false))
+    RT_CHECK(search_many_tester<16>(n, true))
+  }
+}
+
+RT_TEST(test_interpolation_search)
+{
+  for (auto n : {0, 1, 2, 17, 100, 1000}) {
+    auto data = rt::make_rand_data(n, 0, 2 * n, 1);
+    std::sort(std::begin(data), std::end(data));
+
+    // An outlier that makes the interpolation probes useless.
+    auto skewed = data;
+    if (n != 0)
+      skewed.back() = std::numeric_limits<int>::max();
+
+    for (auto const& v : {data, skewed}) {
+      auto b = std::begin(v);
+      auto e = std::end(v);
+      for (auto k = -1; k <= 2 * n + 1; ++k) {
+        RT_CHECK(rt::interpolation_lower_bound(b, e, k) ==
+                 std::lower_bound(b, e, k))
+        RT_CHECK(rt::interpolation_search(b, e, k) ==
+                 std::binary_search(b, e, k))
+      }
+    }
+  }
+}
+
+RT_TEST(test_exponential_search)
+{
+  for (auto n : {0, 1, 2, 17, 100}) {
+    auto data = rt::make_rand_data(n, 0, n, 1);
+    std::sort(std::begin(data), std::end(data));
+    auto b = std::begin(data);
+    auto e = std::end(data);
+    for (auto k = -1; k <= n + 1; ++k) {
+      auto lb = std::lower_bound(b, e, k);
+      for (auto h = b; ; ++h) {
+        RT_CHECK(rt::exponential_lower_bound(b, h, e, k) == lb)
+        if (h == e)
+          break;
+      }
+      RT_CHECK(rt::exponential_search(b, e, k) ==
+               std::binary_search(b, e, k))
+    }
+
+    // The unbounded search stops at the sentinels. It may read up to
+    // 2n + 1 elements.
+    data.resize(2 * n + 1, std::numeric_limits<int>::max());
+    for (auto k = -1; k <= n + 1; ++k) {
+      auto it = rt::unbounded_lower_bound(std::begin(data), k);
+      RT_CHECK(it == std::lower_bound(std::begin(data), std::end(data), k))
+    }
+  }
+}
+
+RT_TEST(test_learned_index)
+{
+  for (auto n : {0, 1, 2, 100, 5000}) {
+    auto data = rt::make_rand_data(n, 0, n, 1);
+    std::sort(std::begin(data), std::end(data));
+    auto b = data.data();
+    auto e = b + n;
+    for (auto eps : {0, 1, 8, 64}) {
+      rt::learned_index index(b, e, eps);
+      RT_CHECK(index.size() == n)
+      RT_CHECK((index.segments() == 0) == (n == 0))
+      for (auto k = -1; k <= n + 1; ++k) {
+        RT_CHECK(index.lower_bound(k) == std::lower_bound(b, e, k))
+        RT_CHECK(index.contains(k) == std::binary_search(b, e, k))
+      }
+    }
+  }
+
+  // Keys far apart and at the ends of the int range.
+  auto const max = std::numeric_limits<int>::max();
+  auto const min = std::numeric_limits<int>::min();
+  std::vector<int> data {min, min, -7, 0, 1 << 20, 1 << 30, max, max};
+  rt::learned_index index(data.data(), data.data() + data.size(), 1);
+  for (auto k : {min, min + 1, -8, -7, 0, 5, 1 << 30, max - 1, max}) {
+    auto p = std::lower_bound(std::begin(data), std::end(data), k);
+    RT_CHECK(index.lower_bound(k) == data.data() + (p - std::begin(data)))
+  }
+}
+
+RT_TEST(test_rotated_view)
+{
+  for (auto n : {0, 1, 2, 5, 40}) {
+    for (auto max : {1, n}) {
+      auto data = rt::make_rand_data(n, 0, max, 1);
+      std::sort(std::begin(data), std::end(data));
+      for (auto r = 0; r < std::max(n, 1); ++r) {
+        auto rot = data;
+        std::rotate( std::begin(rot), std::begin(rot) + std::min(r, n)
+                   , std::end(rot));
+        auto v = rt::make_rotated_view(std::begin(rot), std::end(rot));
+        RT_CHECK(v.size() == n)
+        RT_CHECK(std::equal( v.begin(), v.end()
+                           , std::begin(data), std::end(data)))
+        RT_CHECK(std::equal( std::make_reverse_iterator(v.end())
+                           , std::make_reverse_iterator(v.begin())
+                           , std::rbegin(data), std::rend(data)))
+
+        auto b = std::begin(data);
+        auto e = std::end(data);
+        std::vector<int> queries;
+        for (auto k = -1; k <= max + 1; ++k) {
+          queries.push_back(k);
+          auto lb = std::lower_bound(b, e, k) - b;
+          auto ub = std::upper_bound(b, e, k) - b;
+          RT_CHECK(v.lower_bound(k) - v.begin() == lb)
+          RT_CHECK(v.upper_bound(k) - v.begin() == ub)
+          auto er = v.equal_range(k);
+          RT_CHECK(er.first - v.begin() == lb && er.second - v.begin() == ub)
+          RT_CHECK(v.contains(k) == std::binary_search(b, e, k))
+          auto it = v.find(k);
+          if (it != v.end()) {
+            RT_CHECK(*it == k && *it.base() == k)
+          }
+          auto rg = v.range(k, k + 2);
+          RT_CHECK(rg.second - rg.first ==
+                   std::lower_bound(b, e, k + 2) - std::lower_bound(b, e, k))
+        }
+
+        std::vector<decltype(v.begin())> out;
+        v.lower_bound_many( std::begin(queries), std::end(queries)
+                          , std::back_inserter(out));
+        for (std::size_t i = 0; i < queries.size(); ++i) {
+          RT_CHECK(out[i] == v.lower_bound(queries[i]))
+        }
+      }
+    }
+  }
+
+  // Iterators outlive the view they came from.
+  std::vector<int> rot {5, 6, 7, 1, 2, 3};
+  using view = rt::rotated_view<std::vector<int>::const_iterator>;
+  auto get = [&]()
+  {
+    auto v = std::make_unique<view>(std::cbegin(rot), std::cend(rot));
+    auto w = *v;
+    v.reset();
+    return std::make_pair(w.lower_bound(3), w.end());
+  };
+  auto r = get();
+  RT_CHECK(*r.first == 3 && r.second - r.first == 4)
+  RT_CHECK(r.first[3] == 7 && *(r.first - 2) == 1 && *r.first.base() == 3)
+}
+
+template <class T>
+bool minmax_value_tester(const std::vector<T>& v)
+{
+  std::vector<rt::simd_isa> isas {rt::simd_isa::scalar, rt::simd_best()};
+  auto r = std::minmax_element(std::begin(v), std::end(v));
+  for (auto isa : isas) {
+    auto m = rt::minmax_value(v.data(), v.data() + v.size(), isa);
+    if (m.first != *r.first || m.second != *r.second)
+      return false;
+  }
+  return true;
+}
+
+RT_TEST(test_parallel_scan)
+{
+  // Few distinct values, so there are many ties.
+  for (auto n : {0, 1, 2, 3, 100, 300000}) {
+    auto data = rt::make_rand_data(n, 0, 50, 1);
+    auto b = std::begin(data);
+    auto e = std::end(data);
+    for (auto threads : {1, 3}) {
+      for (auto k : {-1, 0, 25, 50}) {
+        RT_CHECK(rt::parallel_find(b, e, k, threads) == rt::find(b, e, k))
+      }
+      RT_CHECK(rt::parallel_max_element(b, e, threads) ==
+               rt::max_element(b, e))
+      RT_CHECK(rt::parallel_min_element(b, e, threads) ==
+               rt::min_element(b, e))
+    }
+
+    // Only the last element matches.
+    if (n != 0) {
+      auto v = data;
+      std::fill(std::begin(v), std::end(v) - 1, 0);
+      v.back() = 1;
+      RT_CHECK(rt::parallel_find(std::begin(v), std::end(v), 1, 3) ==
+               std::end(v) - 1)
+    }
+
+    RT_CHECK(rt::minmax_element(b, e) == std::minmax_element(b, e))
+    std::forward_list<int> l(b, e);
+    RT_CHECK(rt::minmax_element(std::begin(l), std::end(l)) ==
+             std::minmax_element(std::begin(l), std::end(l)))
+    if (n != 0) {
+      RT_CHECK(minmax_value_tester(data))
+      RT_CHECK(minmax_value_tester(std::vector<short>(b, e)))
+      RT_CHECK(minmax_value_tester(std::vector<float>(b, e)))
+      RT_CHECK(minmax_value_tester(std::vector<double>(b, e)))
+    }
+  }
+}
+
+// Sorted without duplicates, n values drawn from [0, max].
+template <class T>
+std::vector<T> make_set(int n, int max)
+{
+  auto data = rt::make_rand_data(n, 0, max, 1);
+  std::sort(std::begin(data), std::end(data));
+  data.erase(std::unique(std::begin(data), std::end(data)), std::end(data));
+  return {std::begin(data), std::end(data)};
+}
+
+template <class T>
+bool set_ops_tester(const std::vector<T>& a, const std::vector<T>& b)
+{
+  auto check = [&](auto rt_op, auto std_op)
+  {
+    std::vector<T> x;
+    std::vector<T> y;
+    rt_op( std::begin(a), std::end(a), std::begin(b), std::end(b)
+         , std::back_inserter(x));
+    std_op( std::begin(a), std::end(a), std::begin(b), std::end(b)
+          , std::back_inserter(y));
+    return x == y;
+  };
+
+  // Pointer output into a buffer of exactly the size of the result, so
+  // that a store past it shows up under a sanitizer.
+  auto check_ptr = [&](auto rt_op, auto std_op)
+  {
+    std::vector<T> y(a.size() + b.size());
+    auto ly = std_op( a.data(), a.data() + a.size()
+                    , b.data(), b.data() + b.size(), y.data());
+    y.resize(ly - y.data());
+    auto x = std::make_unique<T[]>(y.size());
+    auto lx = rt_op( a.data(), a.data() + a.size()
+                   , b.data(), b.data() + b.size(), x.get());
+    return static_cast<std::size_t>(lx - x.get()) == y.size()
+        && std::equal(x.get(), lx, y.data());
+  };
+
+  using iter = typename std::vector<T>::const_iterator;
+  using out = std::back_insert_iterator<std::vector<T>>;
+  return check( rt::set_intersection<iter, out>
+              , std::set_intersection<iter, iter, out>)
+      && check( rt::set_union<iter, out>
+              , std::set_union<iter, iter, out>)
+      && check( rt::set_difference<iter, out>
+              , std::set_difference<iter, iter, out>)
+      && check_ptr( rt::set_intersection<const T*, T*>
+                  , std::set_intersection<const T*, const T*, T*>)
+      && check_ptr( rt::set_union<const T*, T*>
+                  , std::set_union<const T*, const T*, T*>)
+      && check_ptr( rt::set_difference<const T*, T*>
+                  , std::set_difference<const T*, const T*, T*>);
+}
+
+RT_TEST(test_set_ops)
+{
+  for (auto n : {0, 1, 3, 8, 30, 1000}) {
+    for (auto ratio : {1, 5, 40, 200}) {
+      // Dense enough for many common elements.
+      auto a = make_set<int>(n, 2 * n * ratio);
+      auto b = make_set<int>(n * ratio, 2 * n * ratio);
+      RT_CHECK(set_ops_tester(a, b))
+      RT_CHECK(set_ops_tester(b, a))
+      RT_CHECK(set_ops_tester(a, a))
+      auto la = std::vector<long>(std::begin(a), std::end(a));
+      auto lb = std::vector<long>(std::begin(b), std::end(b));
+      RT_CHECK(set_ops_tester(la, lb))
+      RT_CHECK(set_ops_tester(lb, la))
+    }
+  }
+}
+
 int main()
 {
   try {
@@ -151,6 +538,16 @@ int main()
     test_binary_search2();
     test_binary_search_rec();
     test_binary_search_rotated();
+    test_branchless_lower_bound();
+    test_eytzinger();
+    test_simd_search();
+    test_search_many();
+    test_interpolation_search();
+    test_exponential_search();
+    test_learned_index();
+    test_rotated_view();
+    test_parallel_scan();
+    test_set_ops();
     test_reverse();
     test_find_intrusive1();
     test_find_intrusive2();
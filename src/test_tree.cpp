@@ -1,20 +1,36 @@
+#include <set>
 #include <array>
 #include <vector>
 #include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <numeric>
 #include <iterator>
 #include <iostream>
 #include <algorithm>
+#include <type_traits>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include "rtcpp.hpp"
 #include "test.hpp"
 
-template <class Successor>
+template <class Successor, class Node = rt::bst_node>
 void traversal_tester( const std::vector<int>& input
                      , const std::vector<int>& expected)
 {
-  rt::bst_node root {};
+  Node root {};
+  rt::node_pool<Node> pool;
   for (auto o : input)
-    rt::bst_insert(root, o);
+    rt::bst_insert(root, o, pool);
 
   using iter = rt::bst_iter<Successor>;
 
@@ -103,13 +119,13 @@ void test_bst_postorder()
   std::cout << "postorder_traversal" << std::endl;
   rt::postorder_traversal(root.left);
 
-  //traversal_tester<rt::postorder_successor>({}, {});
+  traversal_tester<rt::postorder_successor>({}, {});
 
-  //traversal_tester<rt::postorder_successor>( {8, 3, 2, 7, 5, 9}
-  //                                         , {2, 5, 7, 3, 9, 8});
+  traversal_tester<rt::postorder_successor>( {8, 3, 2, 7, 5, 9}
+                                           , {2, 5, 7, 3, 9, 8});
 
-  //traversal_tester<rt::postorder_successor>( {1, 2, 3, 4, 5, 6}
-  //                                         , {6, 5, 4, 3, 2, 1});
+  traversal_tester<rt::postorder_successor>( {1, 2, 3, 4, 5, 6}
+                                           , {6, 5, 4, 3, 2, 1});
 
 }
 
@@ -140,12 +156,991 @@ void test_bst_copy()
   if (!b)
     throw std::runtime_error("test_bst_copy");
 
-  //using postorder_iter = rt::bst_iter<rt::postorder_successor>;
-  //auto b = std::equal( postorder_iter {from.left}
-  //                   , postorder_iter {}
-  //                   , postorder_iter {to.left});
-  //if (!b)
-  //  throw std::runtime_error("test_bst_copy");
+  using postorder_iter = rt::bst_iter<rt::postorder_successor>;
+  b = std::equal( postorder_iter {from.left}
+                , postorder_iter {}
+                , postorder_iter {to.left});
+  if (!b)
+    throw std::runtime_error("test_bst_copy");
+}
+
+RT_TEST(test_node_pool)
+{
+  std::vector<int> v {20, 3, 2, 8, 5, 21, 1, 9};
+
+  // A block size smaller than the number of keys forces many blocks.
+  rt::node_pool<> pool(3);
+  rt::bst_node root {};
+  for (auto o : v)
+    rt::bst_insert(root, o, pool);
+
+  using iter = rt::bst_iter<rt::inorder_successor>;
+  std::sort(std::begin(v), std::end(v));
+  RT_CHECK(std::equal(iter {root.left}, iter {}, std::begin(v)))
+
+  // Released nodes are reused before new ones are carved.
+  auto* p = pool.allocate();
+  pool.deallocate(p);
+  RT_CHECK(pool.allocate() == p)
+  RT_CHECK(!p->left && !p->right && p->info == 0)
+
+  rt::bst_clear(root, pool);
+  RT_CHECK(!root.left)
+
+  rt::bst t;
+  for (auto o : v)
+    t.insert(o);
+  RT_CHECK(std::equal(iter {t.head.left}, iter {}, std::begin(v)))
+
+  // One node per block, and sizes below one, which are taken as one.
+  for (auto n : {1, 0, -5}) {
+    rt::node_pool<> q(n);
+    std::set<rt::bst_node*> s;
+    for (auto i = 0; i < 10; ++i) {
+      auto* r = q.allocate();
+      r->info = i;
+      s.insert(r);
+    }
+    RT_CHECK(s.size() == 10)
+    auto i = 0;
+    for (auto* r : s)
+      i += r->info;
+    RT_CHECK(i == 45)
+  }
+
+  // More nodes than fit in one block.
+  rt::node_pool<> big(16);
+  std::vector<rt::bst_node*> w;
+  for (auto i = 0; i < 100; ++i) {
+    w.push_back(big.allocate());
+    w.back()->info = i;
+  }
+  auto ok = true;
+  for (auto i = 0; i < 100; ++i)
+    ok = ok && w[i]->info == i;
+  RT_CHECK(ok)
+}
+
+// Returns the height of an AVL tree or -1 if the balance factors are
+// wrong.
+int avl_height(const rt::bst_node* p)
+{
+  if (!p)
+    return 0;
+
+  auto l = avl_height(p->left);
+  auto r = avl_height(p->right);
+  auto b = static_cast<const rt::avl_node*>(p)->balance;
+  if (l < 0 || r < 0 || r - l != b || b < -1 || 1 < b)
+    return -1;
+
+  return 1 + std::max(l, r);
+}
+
+RT_TEST(test_ordered_set)
+{
+  rt::ordered_set s;
+  RT_CHECK(s.empty())
+  RT_CHECK(s.begin() == s.end())
+  RT_CHECK(s.find(3) == s.end())
+
+  // Sorted input must not degenerate.
+  auto const n = 1 << 12;
+  for (auto i = 0; i < n; ++i)
+    RT_CHECK(s.insert(i))
+
+  RT_CHECK(!s.insert(7))
+  RT_CHECK(s.size() == n)
+  RT_CHECK(0 < avl_height(s.root()) && avl_height(s.root()) <= 13)
+
+  for (auto i = 0; i < n; i += 2)
+    RT_CHECK(s.erase(i))
+
+  RT_CHECK(!s.erase(0))
+  RT_CHECK(s.size() == n / 2)
+  RT_CHECK(avl_height(s.root()) > 0)
+  RT_CHECK(*s.lower_bound(10) == 11)
+  RT_CHECK(*s.lower_bound(11) == 11)
+  RT_CHECK(*s.upper_bound(11) == 13)
+  RT_CHECK(s.upper_bound(n) == s.end())
+  RT_CHECK(s.find(10) == s.end())
+  RT_CHECK(*s.find(11) == 11)
+
+  auto iter = s.find(n - 3);
+  RT_CHECK(*iter++ == n - 3 && *iter++ == n - 1 && iter == s.end())
+
+  // Random operations checked against std::set.
+  std::mt19937 gen(3);
+  std::uniform_int_distribution<int> dis(0, 500);
+  std::set<int> ref;
+  rt::ordered_set s2 {5, 1, 3};
+  ref.insert({5, 1, 3});
+  for (auto i = 0; i < 20000; ++i) {
+    auto k = dis(gen);
+    if (dis(gen) % 3 == 0) {
+      RT_CHECK(s2.erase(k) == (ref.erase(k) == 1))
+    } else {
+      RT_CHECK(s2.insert(k) == ref.insert(k).second)
+    }
+  }
+
+  RT_CHECK(avl_height(s2.root()) >= 0)
+  RT_CHECK(s2.size() == static_cast<int>(ref.size()))
+  RT_CHECK(std::equal(std::begin(s2), std::end(s2), std::begin(ref)))
+
+  for (auto k = -1; k < 502; ++k) {
+    auto a = s2.lower_bound(k);
+    auto b = ref.lower_bound(k);
+    RT_CHECK((a == s2.end()) == (b == std::end(ref)))
+    RT_CHECK(a == s2.end() || *a == *b)
+  }
+}
+
+RT_TEST(test_threaded)
+{
+  using node = rt::threaded_node;
+  using inorder = rt::threaded_inorder_successor;
+  using preorder = rt::threaded_preorder_successor;
+
+  static_assert(sizeof (node) == sizeof (rt::bst_node), "");
+  static_assert(std::is_trivially_copyable<rt::bst_iter<inorder>>::value, "");
+  static_assert(std::is_trivially_copyable<rt::bst_iter<preorder>>::value, "");
+
+  traversal_tester<inorder, node>({}, {});
+  traversal_tester<inorder, node>( {6, 3, 5, 2, 4, 1}
+                                 , {1, 2, 3, 4, 5, 6});
+  traversal_tester<preorder, node>({}, {});
+  traversal_tester<preorder, node>( {8, 3, 2, 7, 5, 9}
+                                  , {8, 3, 2, 7, 5, 9});
+  traversal_tester<preorder, node>( {1, 2, 3, 4, 5, 6}
+                                  , {1, 2, 3, 4, 5, 6});
+  traversal_tester<preorder, node>( {6, 5, 4, 3, 2, 1}
+                                  , {6, 5, 4, 3, 2, 1});
+
+  // Same sequences as the stack based successors on random input.
+  auto data = rt::make_rand_data(1000, 1, 100000);
+
+  rt::bst t1;
+  node t2 {};
+  rt::node_pool<node> pool;
+  for (auto o : data) {
+    t1.insert(o);
+    rt::bst_insert(t2, o, pool);
+  }
+
+  using iter1 = rt::bst_iter<rt::inorder_successor>;
+  using iter2 = rt::bst_iter<inorder>;
+  RT_CHECK(std::equal(iter1 {t1.head.left}, iter1 {}, iter2 {t2.left}))
+
+  using iter3 = rt::bst_iter<rt::preorder_successor>;
+  using iter4 = rt::bst_iter<preorder>;
+  RT_CHECK(std::equal(iter3 {t1.head.left}, iter3 {}, iter4 {t2.left}))
+
+  auto iter = iter2 {t2.left};
+  auto tmp = iter++;
+  RT_CHECK(*tmp < *iter)
+}
+
+template <class Traversal>
+void morris_tester( Traversal traversal
+                  , const std::vector<int>& input
+                  , const std::vector<int>& expected)
+{
+  rt::bst t;
+  for (auto o : input)
+    t.insert(o);
+
+  std::vector<int> out;
+  traversal(t.head.left, [&](auto* p) { out.push_back(p->info); });
+  if (out != expected)
+    throw std::runtime_error("morris_tester");
+
+  // Links must have been restored.
+  out.clear();
+  traversal(t.head.left, [&](auto* p) { out.push_back(p->info); });
+  if (out != expected)
+    throw std::runtime_error("morris_tester");
+}
+
+RT_TEST(test_morris)
+{
+  auto in = [](auto* p, auto v) { rt::inorder_morris(p, v); };
+  auto pre = [](auto* p, auto v) { rt::preorder_morris(p, v); };
+  auto post = [](auto* p, auto v) { rt::postorder_morris(p, v); };
+
+  morris_tester(in, {}, {});
+  morris_tester(in, {6, 3, 5, 2, 4, 1}, {1, 2, 3, 4, 5, 6});
+  morris_tester(pre, {}, {});
+  morris_tester(pre, {8, 3, 2, 7, 5, 9}, {8, 3, 2, 7, 5, 9});
+  morris_tester(pre, {6, 5, 4, 3, 2, 1}, {6, 5, 4, 3, 2, 1});
+  morris_tester(post, {}, {});
+  morris_tester(post, {8, 3, 2, 7, 5, 9}, {2, 5, 7, 3, 9, 8});
+  morris_tester(post, {1, 2, 3, 4, 5, 6}, {6, 5, 4, 3, 2, 1});
+  morris_tester(post, {20, 3, 2, 8, 5}, {2, 5, 8, 3, 20});
+
+  std::cout << "inorder_morris" << std::endl;
+  rt::bst t;
+  for (auto o : {20, 3, 2, 8, 5})
+    t.insert(o);
+  rt::inorder_morris(t.head.left, rt::visit);
+
+  // A degenerate tree, deep enough to hurt a stack based traversal.
+  auto const n = 1000000;
+  std::vector<rt::bst_node> chain(n);
+  for (auto i = 0; i < n; ++i) {
+    chain[i].info = n - i;
+    chain[i].left = i + 1 < n ? &chain[i + 1] : nullptr;
+  }
+
+  auto k = 0;
+  auto up = [&](auto* p) { RT_CHECK(p->info == ++k) };
+  auto down = [&](auto* p) { RT_CHECK(p->info == n - k++) };
+
+  rt::inorder_morris(&chain[0], up);
+  RT_CHECK(k == n)
+  k = 0;
+  rt::postorder_morris(&chain[0], up);
+  RT_CHECK(k == n)
+  k = 0;
+  rt::preorder_morris(&chain[0], down);
+  RT_CHECK(k == n)
+}
+
+// Walks the tree backwards from its end and compares with the
+// reversed forward traversal.
+template <class Successor>
+void reverse_tester(const std::vector<int>& input)
+{
+  rt::bst t;
+  for (auto o : input)
+    t.insert(o);
+
+  using iter = rt::bst_iter<Successor>;
+  std::vector<int> v(iter {t.head.left}, iter {});
+  if (v.size() != input.size())
+    throw std::runtime_error("reverse_tester");
+
+  auto end = rt::bst_end<Successor>(t.head.left);
+  auto b = std::equal( std::make_reverse_iterator(end)
+                     , std::make_reverse_iterator(iter {t.head.left})
+                     , v.rbegin()
+                     , v.rend());
+  if (!b)
+    throw std::runtime_error("reverse_tester");
+
+  // Zig-zag through the sequence.
+  auto pos = iter {t.head.left};
+  for (std::size_t i = 0; i + 1 < v.size(); ++i) {
+    ++pos;
+    auto tmp = pos--;
+    if (*pos != v[i] || *tmp != v[i + 1])
+      throw std::runtime_error("reverse_tester");
+    ++pos;
+  }
+}
+
+RT_TEST(test_bst_reverse)
+{
+  using in = rt::inorder_successor;
+  using pre = rt::preorder_successor;
+  using post = rt::postorder_successor;
+
+  reverse_tester<in>({});
+  reverse_tester<pre>({});
+  reverse_tester<post>({});
+
+  std::vector<std::vector<int>> inputs
+  { {8, 3, 2, 7, 5, 9}
+  , {1, 2, 3, 4, 5, 6}
+  , {6, 5, 4, 3, 2, 1}
+  , {4}
+  , rt::make_rand_data(500, 1, 10000)
+  };
+
+  for (auto const& v : inputs) {
+    reverse_tester<in>(v);
+    reverse_tester<pre>(v);
+    reverse_tester<post>(v);
+  }
+
+  rt::ordered_set s {3, 1, 4, 5, 9, 2, 6};
+  auto iter = s.end();
+  RT_CHECK(*--iter == 9)
+  RT_CHECK(*--iter == 6)
+  iter = s.find(4);
+  RT_CHECK(*--iter == 3)
+  RT_CHECK(*std::prev(s.lower_bound(7)) == 6)
+
+  using category = std::iterator_traits<rt::ordered_set::iterator>;
+  static_assert(std::is_same< category::iterator_category
+                            , std::bidirectional_iterator_tag>::value, "");
+}
+
+RT_TEST(test_veb)
+{
+  RT_CHECK(!rt::veb_find(rt::freeze(nullptr), 0))
+
+  for (auto n = 1; n < 300; n += 7) {
+    auto data = rt::make_rand_data(n, 0, 4 * n);
+    rt::bst t;
+    for (auto o : data)
+      t.insert(o);
+
+    auto v = rt::freeze(t.head.left);
+    RT_CHECK(v.keys.size() + 1 >= data.size())
+    for (auto k = -1; k <= 4 * n + 1; ++k)
+      RT_CHECK(rt::veb_find(v, k) == !!rt::bst_find(t.head.left, k))
+  }
+
+  // A complete tree of height 4 in van Emde Boas order.
+  rt::bst t;
+  for (auto o : {8, 4, 12, 2, 6, 10, 14, 1, 3, 5, 7, 9, 11, 13, 15})
+    t.insert(o);
+
+  std::vector<int> expected
+    {8, 4, 12, 2, 1, 3, 6, 5, 7, 10, 9, 11, 14, 13, 15};
+  RT_CHECK(rt::freeze(t.head.left).keys == expected)
+}
+
+template <class Successor>
+bool same_traversal(rt::bst_node* a, rt::bst_node* b)
+{
+  using iter = rt::bst_iter<Successor>;
+  return std::equal(iter {a}, iter {}, iter {b}, iter {});
+}
+
+void parallel_copy_tester(const std::vector<int>& v, int threads)
+{
+  rt::bst from;
+  for (auto o : v)
+    from.insert(o);
+
+  rt::node_pool<> pool;
+  rt::bst_node to {};
+  to.left = rt::parallel_copy(from.head.left, pool, threads);
+
+  auto b = same_traversal<rt::preorder_successor>(from.head.left, to.left)
+        && same_traversal<rt::inorder_successor>(from.head.left, to.left)
+        && same_traversal<rt::postorder_successor>(from.head.left, to.left);
+  if (!b)
+    throw std::runtime_error("parallel_copy_tester");
+
+  // All nodes are in one block.
+  using iter = rt::bst_iter<rt::inorder_successor>;
+  auto n = std::distance(iter {to.left}, iter {});
+  std::vector<const rt::bst_node*> nodes;
+  rt::inorder_morris(to.left, [&](auto* p) { nodes.push_back(p); });
+  auto mm = std::minmax_element(std::begin(nodes), std::end(nodes));
+  if (n != 0 && *mm.second - *mm.first != n - 1)
+    throw std::runtime_error("parallel_copy_tester");
+}
+
+void test_bst_parallel_copy()
+{
+  std::cout << "test_bst_parallel_copy" << std::endl;
+
+  parallel_copy_tester({}, 4);
+  parallel_copy_tester({20, 3, 2, 8, 5}, 1);
+  parallel_copy_tester({20, 3, 2, 8, 5}, 4);
+  parallel_copy_tester({1, 2, 3, 4, 5, 6, 7, 8, 9, 10}, 2);
+  parallel_copy_tester(rt::make_rand_data(100000, 1, 1000000), 1);
+  parallel_copy_tester(rt::make_rand_data(100000, 1, 1000000), 4);
+}
+
+int bst_height(const rt::bst_node* p)
+{
+  if (!p)
+    return 0;
+
+  return 1 + std::max(bst_height(p->left), bst_height(p->right));
+}
+
+RT_TEST(test_bst_build)
+{
+  using iter = rt::bst_iter<rt::inorder_successor>;
+
+  for (auto n = 0; n < 100; ++n) {
+    std::vector<int> v(n);
+    std::iota(std::begin(v), std::end(v), -n / 2);
+
+    rt::bst t;
+    t.head.left = rt::bst_build(std::begin(v), std::end(v), t.pool);
+    auto* root = t.head.left;
+    RT_CHECK(std::equal(iter {root}, iter {}, std::begin(v), std::end(v)))
+
+    auto h = 0;
+    while ((1 << h) - 1 < n)
+      ++h;
+    RT_CHECK(bst_height(t.head.left) == h)
+
+    // Insertion keeps working on the built tree.
+    t.insert(n);
+    RT_CHECK(rt::bst_find(t.head.left, n))
+
+    // Nodes of the block go back to the pool and are reused.
+    rt::bst_clear(t.head, t.pool);
+    for (auto i = 0; i <= n; ++i)
+      t.insert(i);
+    RT_CHECK(std::distance(iter {t.head.left}, iter {}) == n + 1)
+  }
+
+  auto v = rt::make_rand_data(1 << 20, 0, 1 << 30);
+  std::sort(std::begin(v), std::end(v));
+
+  rt::node_pool<> pool;
+  auto* a = rt::bst_build(std::begin(v), std::end(v), pool);
+  auto* b = rt::bst_build(std::begin(v), std::end(v), pool, 4);
+  RT_CHECK(std::equal(iter {a}, iter {}, std::begin(v), std::end(v)))
+  RT_CHECK(same_traversal<rt::preorder_successor>(a, b))
+}
+
+template <int G>
+void find_many_tester(const rt::bst& t, const std::vector<int>& keys)
+{
+  std::vector<const rt::bst_node*> r;
+  rt::bst_find_many<G>( t.head.left, std::begin(keys), std::end(keys)
+                      , std::back_inserter(r));
+
+  if (r.size() != keys.size())
+    throw std::runtime_error("find_many_tester");
+
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    if (r[i] != rt::bst_find(t.head.left, keys[i]))
+      throw std::runtime_error("find_many_tester");
+}
+
+RT_TEST(test_bst_find_many)
+{
+  rt::bst t;
+  auto keys = rt::make_rand_data(1000, 0, 100, 1);
+  find_many_tester<16>(t, keys);
+
+  for (auto o : rt::make_rand_data(5000, 0, 20000))
+    t.insert(o);
+
+  keys = rt::make_rand_data(1000, 0, 20000, 1);
+  find_many_tester<1>(t, keys);
+  find_many_tester<3>(t, keys);
+  find_many_tester<16>(t, keys);
+  find_many_tester<16>(t, {});
+
+  std::vector<int> v {t.head.left->info, -1};
+  std::vector<const rt::bst_node*> r(2);
+  rt::bst_find_many(t.head.left, std::begin(v), std::end(v), std::begin(r));
+  RT_CHECK(r[0] == t.head.left && !r[1])
+}
+
+struct key16 {
+  std::uint64_t hi;
+  std::uint64_t lo;
+};
+
+struct key16_less {
+  bool operator()(const key16& a, const key16& b) const noexcept
+  { return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo); }
+};
+
+struct plain_node {
+  int info;
+  plain_node* left;
+  plain_node* right;
+};
+
+RT_TEST(test_bst_generic)
+{
+  static_assert(sizeof (rt::bst_node) == sizeof (plain_node), "");
+
+  auto data = rt::make_rand_data(1000, 0, 200);
+  std::set<int> ref(std::begin(data), std::end(data));
+
+  // Composite keys with a move-only payload.
+  using map = rt::basic_bst<key16, std::unique_ptr<std::string>, key16_less>;
+  map t;
+  for (auto o : data) {
+    auto v = std::make_unique<std::string>(std::to_string(o));
+    auto* raw = v.get();
+    auto h = static_cast<std::uint64_t>(o);
+    key16 k {h % 7, h};
+    auto fresh = !t.find(k);
+    auto* p = t.insert(k, std::move(v));
+    RT_CHECK(*p->value == std::to_string(o))
+    RT_CHECK(fresh == (p->value.get() == raw))
+  }
+
+  using iter = rt::bst_iter<rt::basic_inorder_successor<map::node_type>>;
+  static_assert(std::is_same<iter::value_type, key16>::value, "");
+  RT_CHECK(std::is_sorted(iter(t.head.left), iter(), key16_less {}))
+  auto n = 0;
+  for (iter it(t.head.left); it != iter(); ++it, ++n) {
+    RT_CHECK(*it.node()->value == std::to_string((*it).lo))
+    RT_CHECK(t.find(*it) == it.node())
+  }
+  RT_CHECK(n == static_cast<int>(ref.size()))
+  RT_CHECK(!t.find({0, 1}))
+
+  // A reversed comparator.
+  rt::basic_bst<int, void, std::greater<int>> g;
+  for (auto o : data)
+    g.insert(o);
+
+  using giter = rt::bst_iter<rt::inorder_successor>;
+  RT_CHECK(std::equal( giter(g.head.left), giter()
+                     , std::rbegin(ref), std::rend(ref)))
+  RT_CHECK(g.find(*std::begin(ref)) && !g.find(-1))
+}
+
+RT_TEST(test_avl_insert_copy)
+{
+  auto data = rt::make_rand_data(500, 0, 1000);
+  rt::node_pool<rt::avl_node> pool;
+  std::vector<rt::bst_node*> path;
+  std::vector<rt::bst_node*> roots {nullptr};
+  for (auto o : data) {
+    auto* r = rt::avl_insert_copy(roots.back(), o, pool, path);
+    if (r == roots.back()) {
+      RT_CHECK(path.empty())
+    } else {
+      RT_CHECK(path.empty() || path.front() == roots.back())
+    }
+    roots.push_back(r);
+  }
+
+  // Every version still holds exactly the keys inserted before it and
+  // is still balanced.
+  using iter = rt::bst_iter<rt::inorder_successor>;
+  std::set<int> ref;
+  for (std::size_t i = 0; i != data.size(); ++i) {
+    RT_CHECK(std::equal( iter(roots[i]), iter()
+                       , std::begin(ref), std::end(ref)))
+    RT_CHECK(avl_height(roots[i]) >= 0)
+    ref.insert(data[i]);
+  }
+  RT_CHECK(std::equal( iter(roots.back()), iter()
+                     , std::begin(ref), std::end(ref)))
+}
+
+RT_TEST(test_concurrent_bst)
+{
+  auto const n = 5000;
+  auto const readers = 3;
+  std::vector<int> data(n);
+  std::iota(std::begin(data), std::end(data), 0);
+  std::shuffle(std::begin(data), std::end(data), std::mt19937 {});
+
+  rt::concurrent_bst t(readers + 1);
+  std::atomic<bool> done {false};
+  std::atomic<int> errors {0};
+
+  auto read = [&](int id)
+  {
+    std::ptrdiff_t last = 0;
+    while (!done) {
+      rt::concurrent_bst::snapshot s(t, id);
+      auto it = s.begin();
+      auto m = std::distance(it, s.end());
+      if (m < last || !std::is_sorted(it, s.end()))
+        ++errors;
+      if (s.root() && !s.contains(s.root()->info))
+        ++errors;
+      last = m;
+      std::this_thread::yield();
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (auto i = 0; i < readers; ++i)
+    pool.emplace_back(read, i);
+
+  for (auto o : data)
+    t.insert(o);
+  done = true;
+  for (auto& o : pool)
+    o.join();
+
+  RT_CHECK(errors == 0)
+
+  t.reclaim();
+  RT_CHECK(t.pending() == 0)
+
+  // A pinned version outlives later insertions.
+  rt::concurrent_bst::snapshot s(t, readers);
+  for (auto o : data)
+    t.insert(n + o);
+  t.reclaim();
+  RT_CHECK(t.pending() != 0)
+  RT_CHECK(std::distance(s.begin(), s.end()) == n)
+  std::vector<int> v(s.begin(), s.end());
+  RT_CHECK(v.front() == 0 && v.back() == n - 1)
+
+  // Sorted input stays balanced, which bounds the iterator stacks.
+  rt::concurrent_bst u(1);
+  auto const m = 1 << 12;
+  for (auto i = 0; i < m; ++i)
+    u.insert(i);
+  rt::concurrent_bst::snapshot su(u, 0);
+  RT_CHECK(0 < avl_height(su.root()) && avl_height(su.root()) <= 13)
+  RT_CHECK(std::distance(su.begin(), su.end()) == m)
+  RT_CHECK(*std::prev(su.end()) == m - 1 && *su.begin()++ == 0)
+}
+
+template <int B>
+void btree_tester(const std::vector<int>& data)
+{
+  rt::btree<B> t;
+  std::set<int> ref;
+  for (auto o : data) {
+    if (t.insert(o) != ref.insert(o).second)
+      throw std::runtime_error("btree_tester");
+  }
+
+  auto ok = t.size() == static_cast<int>(ref.size())
+         && std::equal(t.begin(), t.end(), std::begin(ref), std::end(ref));
+
+  for (auto o : rt::make_rand_data(2000, -10, 5010)) {
+    auto it = ref.lower_bound(o);
+    auto jt = t.lower_bound(o);
+    ok = ok && (it == std::end(ref) ? jt == t.end() : *jt == *it);
+    ok = ok && ((t.find(o) != t.end()) == (ref.count(o) == 1));
+  }
+
+  if (!ok)
+    throw std::runtime_error("btree_tester");
+}
+
+RT_TEST(test_btree)
+{
+  rt::btree<> t;
+  RT_CHECK(t.empty() && t.begin() == t.end() && t.find(1) == t.end())
+  RT_CHECK(t.lower_bound(1) == t.end())
+
+  auto data = rt::make_rand_data(5000, 0, 5000);
+  data.push_back(std::numeric_limits<int>::max());
+  data.push_back(std::numeric_limits<int>::min());
+
+  btree_tester<4>(data);
+  btree_tester<16>(data);
+  btree_tester<32>(data);
+
+  std::sort(std::begin(data), std::end(data));
+  btree_tester<4>(data);
+  btree_tester<16>(data);
+
+  // The in-node search, whichever path is compiled, against the scalar
+  // one on a partly filled node.
+  alignas(64) std::array<int, 16> keys;
+  keys.fill(std::numeric_limits<int>::max());
+  for (auto i = 0; i < 11; ++i)
+    keys[i] = data[i * 400];
+  for (std::size_t i = 1; i + 1 < data.size(); ++i) {
+    auto k = data[i] + static_cast<int>(i % 3) - 1;
+    RT_CHECK( rt::btree_rank<16>(keys.data(), k)
+           == rt::btree_rank_scalar<16>(keys.data(), k))
+  }
+  for (auto k : {data.front(), data.back(), keys[0], keys[10]}) {
+    RT_CHECK( rt::btree_rank<16>(keys.data(), k)
+           == rt::btree_rank_scalar<16>(keys.data(), k))
+  }
+  RT_CHECK(rt::btree_rank_scalar<16>(keys.data(), keys[3]) == 3)
+
+  for (auto o : data)
+    t.insert(o);
+  RT_CHECK(t.levels() > 1 && t.find(data[7]) != t.end())
+  RT_CHECK(*t.find(data[7]) == data[7])
+  RT_CHECK(*t.find(std::numeric_limits<int>::max()) == data.back())
+}
+
+RT_TEST(test_bst_stats)
+{
+  RT_CHECK(rt::bst_shape<rt::bst_node>(nullptr).nodes == 0)
+  RT_CHECK(rt::bst_sample<rt::bst_node>(nullptr, 10).height == 0)
+
+  rt::bst t;
+  for (auto o : {20, 3, 2, 8, 5})
+    t.insert(o);
+
+  auto a = rt::bst_shape(t.head.left, true);
+  RT_CHECK(a.nodes == 5 && a.height == 4 && a.min_height() == 3)
+  RT_CHECK(a.avg_depth == 13.0 / 5 && a.bytes == 5 * 24)
+  RT_CHECK((a.depths == std::vector<long long> {1, 1, 2, 1}))
+  RT_CHECK(!a.sampled)
+
+  std::ostringstream os;
+  os << a;
+  RT_CHECK(os.str().find("bst_nodes 5\n") != std::string::npos)
+  RT_CHECK(os.str().find("bst_depth_nodes{depth=\"3\"} 2\n")
+           != std::string::npos)
+
+  // Paths and full trees look the same from every walk, so the
+  // estimates are exact.
+  rt::bst c;
+  for (auto i = 0; i < 100; ++i)
+    c.insert(i);
+  auto b = rt::bst_sample(c.head.left, 5);
+  RT_CHECK(b.sampled && b.nodes == 100 && b.height == 100)
+
+  std::vector<int> v(1023);
+  std::iota(std::begin(v), std::end(v), 0);
+  rt::node_pool<> pool;
+  auto* root = rt::bst_build(std::begin(v), std::end(v), pool);
+  auto d = rt::bst_sample(root, 5, true);
+  auto e = rt::bst_shape(root, true);
+  RT_CHECK(d.nodes == 1023 && d.height == 10 && d.min_height() == 10)
+  RT_CHECK(d.depths == e.depths && d.avg_depth == e.avg_depth)
+
+  // The estimates vary a lot between random trees, so the tree is
+  // fixed.
+  std::vector<int> keys(20000);
+  std::iota(std::begin(keys), std::end(keys), 0);
+  std::shuffle(std::begin(keys), std::end(keys), std::mt19937 {});
+  rt::bst r;
+  for (auto o : keys)
+    r.insert(o);
+  auto x = rt::bst_shape(r.head.left);
+  auto y = rt::bst_sample(r.head.left, 4000);
+  RT_CHECK(std::abs(y.nodes - x.nodes) < x.nodes / 4)
+  RT_CHECK(std::abs(y.avg_depth - x.avg_depth) < 2)
+  RT_CHECK(y.height <= x.height && x.height < 3 * x.min_height())
+}
+
+void int_set_tester(const std::vector<int>& data)
+{
+  rt::int_set t;
+  std::set<int> ref;
+  for (auto o : data) {
+    if (t.insert(o) != ref.insert(o).second)
+      throw std::runtime_error("int_set_tester");
+  }
+
+  std::vector<int> v(t.size());
+  std::copy(t.begin(), rt::int_set::iterator {}, std::begin(v));
+  auto ok = t.size() == static_cast<int>(ref.size())
+         && std::equal(std::begin(v), std::end(v), std::begin(ref));
+
+  auto min = std::numeric_limits<int>::min();
+  auto max = std::numeric_limits<int>::max();
+  auto queries = rt::make_rand_data(1000, -3000, 3000);
+  for (auto o : {min, min + 1, -1, 0, 1, max - 1, max})
+    queries.push_back(o);
+  for (auto o : data)
+    queries.push_back(o);
+
+  for (auto o : queries) {
+    auto same = [&](auto it, auto jt)
+    { return it == std::end(ref) ? jt == t.end() : *jt == *it; };
+
+    ok = ok && t.contains(o) == (ref.count(o) == 1);
+    ok = ok && (t.find(o) != t.end()) == t.contains(o);
+    ok = ok && same(ref.lower_bound(o), t.lower_bound(o));
+    ok = ok && same(ref.upper_bound(o), t.successor(o));
+    auto it = ref.lower_bound(o);
+    auto p = t.predecessor(o);
+    ok = ok && (it == std::begin(ref) ? p == t.end() : *p == *--it);
+  }
+
+  if (!ok)
+    throw std::runtime_error("int_set_tester");
+}
+
+RT_TEST(test_int_set)
+{
+  rt::int_set t;
+  RT_CHECK(t.empty() && t.begin() == t.end())
+  RT_CHECK(t.lower_bound(0) == t.end() && t.predecessor(0) == t.end())
+  using traits = std::iterator_traits<rt::int_set::iterator>;
+  static_assert(std::is_same< traits::iterator_category
+                            , std::input_iterator_tag>::value
+               , "int_set iterators are input iterators.");
+
+  auto min = std::numeric_limits<int>::min();
+  auto max = std::numeric_limits<int>::max();
+
+  int_set_tester(rt::make_rand_data(3000, -2000, 2000));
+  int_set_tester(rt::make_rand_data(3000, min, max));
+  int_set_tester({min, max, 0, -1, 63, 64, -64, -65});
+
+  std::vector<int> dense(100000);
+  std::iota(std::begin(dense), std::end(dense), -50000);
+  for (auto o : dense)
+    t.insert(o);
+  RT_CHECK(std::equal(t.begin(), t.end(), std::begin(dense)))
+  RT_CHECK(t.bytes() < dense.size())
+}
+
+RT_TEST(test_bst_splay)
+{
+  rt::bst_node head {};
+  RT_CHECK(!rt::bst_splay_find(head, 1))
+
+  auto data = rt::make_rand_data(2000, 0, 5000);
+  std::set<int> ref(std::begin(data), std::end(data));
+  rt::node_pool<> pool;
+  for (auto o : data)
+    rt::bst_insert(head, o, pool);
+
+  using iter = rt::bst_iter<rt::inorder_successor>;
+  for (auto o : rt::make_rand_data(3000, -10, 5010, 1)) {
+    auto* p = rt::bst_splay_find(head, o);
+    if (ref.count(o)) {
+      RT_CHECK(p && p == head.left && p->info == o)
+    } else {
+      RT_CHECK(!p && head.left)
+    }
+  }
+  RT_CHECK(std::equal(iter(head.left), iter(), std::begin(ref), std::end(ref)))
+
+  // A key accessed twice in a row is found at the root.
+  auto k = *std::next(std::begin(ref), ref.size() / 3);
+  rt::bst_splay_find(head, k);
+  RT_CHECK(rt::bst_splay_find(head, k) == head.left)
+  RT_CHECK(head.left->info == k)
+
+  // Splaying around missing keys brings their neighbours up.
+  head.left = rt::bst_splay(head.left, -1);
+  RT_CHECK(head.left->info == *std::begin(ref))
+  head.left = rt::bst_splay(head.left, 6000);
+  RT_CHECK(head.left->info == *std::rbegin(ref))
+
+  rt::basic_bst<int, void, std::greater<int>> g;
+  for (auto o : data)
+    g.insert(o);
+  auto* p = rt::bst_splay_find(g.head, k, g.comp);
+  RT_CHECK(p == g.head.left && p->info == k)
+
+  auto z = rt::make_zipf_data(10000, 100);
+  RT_CHECK(std::count(std::begin(z), std::end(z), 0) > 1000)
+  RT_CHECK(*std::max_element(std::begin(z), std::end(z)) < 100)
+  RT_CHECK(*std::min_element(std::begin(z), std::end(z)) >= 0)
+}
+
+RT_TEST(test_persistent_bst)
+{
+  rt::persistent_bst<> t;
+  RT_CHECK(t.version() == 0 && !t.root() && t.begin(0) == t.end(0))
+
+  auto data = rt::make_rand_data(3000, 0, 10000);
+  std::vector<std::set<int>> refs(1);
+  for (auto o : data) {
+    auto v = t.insert(o);
+    RT_CHECK(v == static_cast<int>(refs.size()))
+    refs.push_back(refs.back());
+    refs.back().insert(o);
+  }
+  RT_CHECK(t.insert(data[0]) == t.version())
+
+  // Old versions are untouched and share most nodes with the new ones.
+  for (auto v = 0; v < t.version(); v += 97) {
+    RT_CHECK(std::equal( t.begin(v), t.end(v)
+                       , std::begin(refs[v]), std::end(refs[v])))
+    RT_CHECK(!t.find(data[v], v) && t.find(data[v], v + 1))
+  }
+  RT_CHECK(*std::prev(t.end(1)) == data[0])
+
+  auto n = refs.back().size();
+  t.compact();
+  RT_CHECK(t.version() == 0)
+  RT_CHECK(std::equal( t.begin(0), t.end(0)
+                     , std::begin(refs.back()), std::end(refs.back())))
+  RT_CHECK(t.insert(-1) == 1 && t.find(-1, 1) && !t.find(-1, 0))
+  RT_CHECK(std::distance(t.begin(1), t.end(1)) == static_cast<int>(n + 1))
+
+  // Sorted input, the usual case for time-ordered keys, must copy
+  // O(log n) nodes per insertion rather than the whole spine.
+  rt::persistent_bst<> s;
+  auto const m = 1 << 12;
+  for (auto i = 0; i < m; ++i)
+    s.insert(i);
+  RT_CHECK(s.nodes_copied() <= static_cast<std::size_t>(m) * (13 + 1))
+  RT_CHECK(0 < avl_height(s.root()) && avl_height(s.root()) <= 13)
+  RT_CHECK(avl_height(s.root(m / 2)) > 0)
+  RT_CHECK(std::distance(s.begin(m / 2), s.end(m / 2)) == m / 2)
+  RT_CHECK(!s.find(m / 2, m / 2) && s.find(m / 2 - 1, m / 2))
+  s.compact();
+  RT_CHECK(s.nodes_copied() == 0 && avl_height(s.root()) == 13)
+  std::vector<int> keys(m);
+  std::iota(std::begin(keys), std::end(keys), 0);
+  RT_CHECK(std::equal(s.begin(0), s.end(0), std::begin(keys), std::end(keys)))
+
+  rt::persistent_bst<rt::bst_node, std::greater<int>> g;
+  for (auto o : {3, 1, 2})
+    g.insert(o);
+  std::vector<int> v(g.begin(3), g.end(3));
+  RT_CHECK((v == std::vector<int> {3, 2, 1}))
+  g.compact();
+  RT_CHECK(g.find(2, 0) && !g.find(4, 0))
+}
+
+void bst_view_tester(const rt::bst_view& v, const rt::bst& t)
+{
+  using iter = rt::bst_iter<rt::preorder_successor>;
+  auto n = std::distance(iter(t.head.left), iter());
+  auto ok = v.valid() && v.size() == n;
+
+  iter it(t.head.left);
+  for (auto i = 0; ok && i < n; ++i, ++it)
+    ok = v[i].info == *it && v.find(*it) == &v[i];
+
+  for (auto o : rt::make_rand_data(500, -100, 10100, 1))
+    ok = ok && !v.find(o) == !rt::bst_find(t.head.left, o);
+
+  if (!ok)
+    throw std::runtime_error("bst_view_tester");
+}
+
+RT_TEST(test_bst_serialize)
+{
+  rt::bst t;
+  for (auto o : rt::make_rand_data(3000, 0, 10000))
+    t.insert(o);
+
+  std::ostringstream os;
+  RT_CHECK(rt::bst_serialize(t.head.left, os))
+  auto buf = os.str();
+  RT_CHECK(buf.size() == sizeof (rt::bst_flat_header)
+                       + 12 * rt::bst_shape(t.head.left).nodes)
+  bst_view_tester(rt::bst_view(buf.data(), buf.size()), t);
+
+  RT_CHECK(!rt::bst_view(buf.data(), buf.size() - 1).valid())
+  RT_CHECK(!rt::bst_view(buf.data(), 3).valid())
+  RT_CHECK(!rt::bst_view().valid())
+  auto bad = buf;
+  bad[0] = 'X';
+  RT_CHECK(!rt::bst_view(bad.data(), bad.size()).valid())
+
+  // Child links that would loop or leave the buffer.
+  auto corrupt = [&](int i, int side, std::int32_t c)
+  {
+    auto b = buf;
+    auto off = sizeof (rt::bst_flat_header) + 12 * i + 4 * (1 + side);
+    std::memcpy(&b[off], &c, sizeof c);
+    return rt::bst_view(b.data(), b.size()).valid();
+  };
+  std::int32_t n = rt::bst_shape(t.head.left).nodes;
+  RT_CHECK(!corrupt(5, 0, 0) && !corrupt(5, 1, 5) && !corrupt(0, 1, n))
+  RT_CHECK(!corrupt(n - 1, 0, -2) && corrupt(n - 1, 1, -1))
+
+  std::ostringstream es;
+  rt::bst_serialize(nullptr, es);
+  auto empty = es.str();
+  rt::bst_view ev(empty.data(), empty.size());
+  RT_CHECK(ev.valid() && ev.size() == 0 && !ev.find(1))
+
+#if defined(__unix__)
+  char name[] = "/tmp/rt_bst_XXXXXX";
+  auto fd = mkstemp(name);
+  RT_CHECK(fd != -1)
+  {
+    std::ofstream ofs(name, std::ios::binary);
+    rt::bst_serialize(t.head.left, ofs);
+  }
+
+  auto size = lseek(fd, 0, SEEK_END);
+  auto* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  unlink(name);
+  RT_CHECK(p != MAP_FAILED)
+  bst_view_tester(rt::bst_view(p, size), t);
+  munmap(p, size);
+#endif
 }
 
 int main()
@@ -154,6 +1149,25 @@ int main()
     test_bst_preorder();
     test_bst_inorder();
     test_bst_postorder();
+    test_bst_copy();
+    test_node_pool();
+    test_ordered_set();
+    test_threaded();
+    test_morris();
+    test_bst_reverse();
+    test_veb();
+    test_bst_parallel_copy();
+    test_bst_build();
+    test_bst_find_many();
+    test_bst_generic();
+    test_avl_insert_copy();
+    test_concurrent_bst();
+    test_btree();
+    test_bst_stats();
+    test_int_set();
+    test_bst_splay();
+    test_persistent_bst();
+    test_bst_serialize();
   } catch (...) {
     std::cerr << "Error." << std::endl;
     return 1;
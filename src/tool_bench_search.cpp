@@ -0,0 +1,459 @@
+#include <string>
+#include <limits>
+#include <iostream>
+
+#include "rtcpp.hpp"
+
+using namespace rt;
+
+// Returns the average time in nanoseconds f takes per query.
+template <class F>
+auto ns_per_query(std::vector<int> const& queries, F f)
+{
+  long long sum = 0;
+  auto t = std::chrono::steady_clock::now();
+  for (auto o : queries)
+    sum += f(o);
+  std::chrono::nanoseconds d = std::chrono::steady_clock::now() - t;
+
+  // Keeps the loop from being optimized away.
+  if (sum == 42)
+    std::cout << " ";
+
+  return d.count() / double(queries.size());
+}
+
+// Searches for random keys in sorted arrays of 2^10 ints, which fit in
+// L1, up to 2^e ints, well above the last level cache for the
+// default.
+void bench_search(int e)
+{
+  std::cout << "# size(bytes) std::lower_bound lower_bound "
+               "binary_search binary_search2 binary_search_recursive "
+               "branchless eytzinger (ns per query)" << std::endl;
+
+  auto const m = 2000000;
+  std::mt19937 gen;
+
+  for (auto k = 10; k <= e; k += 2) {
+    auto n = 1 << k;
+    std::vector<int> data(n);
+    for (auto i = 0; i < n; ++i)
+      data[i] = 2 * i;
+
+    auto eyt = make_eytzinger(std::begin(data), std::end(data));
+
+    std::uniform_int_distribution<int> dis(0, 2 * n);
+    std::vector<int> queries(m);
+    for (auto& o : queries)
+      o = dis(gen);
+
+    auto f = std::begin(data);
+    auto l = std::end(data);
+    std::cout << n * sizeof (int) << " "
+      << ns_per_query(queries, [&](int o)
+         { return std::lower_bound(f, l, o) - f; }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return rt::lower_bound(f, l, o) - f; }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return rt::binary_search(f, l, o); }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return binary_search2(f, l, o); }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return binary_search_recursive(f, l, o); }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return branchless_lower_bound(f, l, o) - f; }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return eytzinger_lower_bound(eyt, o); })
+      << std::endl;
+  }
+}
+
+// Small arrays, where the linear and k-ary SIMD searches compete with
+// the binary searches. The find columns look for keys that are in the
+// array, so find_with_sentinel needs no sentinel.
+void bench_small()
+{
+  // Never asks for more than the CPU has.
+  auto isa = [](simd_isa i) { return std::min(i, simd_best()); };
+  auto const sse2 = isa(simd_isa::sse2);
+  auto const avx2 = isa(simd_isa::avx2);
+
+  std::cout << "# size find find_with_sentinel simd_find(sse2) "
+               "simd_find(avx2) std::lower_bound binary_search "
+               "branchless kary(scalar) kary(sse2) kary(avx2) "
+               "(ns per query)" << std::endl;
+
+  auto const m = 2000000;
+  std::mt19937 gen;
+
+  for (auto n : {16, 32, 64, 128, 256, 512, 1024, 4096}) {
+    std::vector<int> data(n);
+    for (auto i = 0; i < n; ++i)
+      data[i] = 2 * i;
+
+    std::uniform_int_distribution<int> in(0, n - 1);
+    std::vector<int> hits(m);
+    for (auto& o : hits)
+      o = 2 * in(gen);
+
+    std::uniform_int_distribution<int> dis(0, 2 * n);
+    std::vector<int> queries(m);
+    for (auto& o : queries)
+      o = dis(gen);
+
+    auto f = data.data();
+    auto l = f + n;
+    std::cout << n << " "
+      << ns_per_query(hits, [&](int o)
+         { return rt::find(f, l, o) - f; }) << " "
+      << ns_per_query(hits, [&](int o)
+         { return find_with_sentinel(f, o) - f; }) << " "
+      << ns_per_query(hits, [&](int o)
+         { return simd_find(f, l, o, sse2) - f; }) << " "
+      << ns_per_query(hits, [&](int o)
+         { return simd_find(f, l, o, avx2) - f; }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return std::lower_bound(f, l, o) - f; }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return rt::binary_search(f, l, o); }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return branchless_lower_bound(f, l, o) - f; }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return kary_lower_bound(f, l, o, simd_isa::scalar) - f; })
+      << " "
+      << ns_per_query(queries, [&](int o)
+         { return kary_lower_bound(f, l, o, sse2) - f; }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return kary_lower_bound(f, l, o, avx2) - f; })
+      << std::endl;
+  }
+}
+
+// Batches of 2^10 to 2^20 random keys against 2^e sorted ints, one
+// rt::binary_search call at a time and through the batched searches.
+// The last column is the time it takes to sort the batch.
+void bench_batch(int e)
+{
+  std::cout << "# batch binary_search std::lower_bound "
+               "lower_bound_many lower_bound_many(sorted) std::sort "
+               "(ns per query)" << std::endl;
+
+  auto const n = 1 << e;
+  std::vector<int> data(n);
+  for (auto i = 0; i < n; ++i)
+    data[i] = 2 * i;
+
+  auto f = std::begin(data);
+  auto l = std::end(data);
+  std::mt19937 gen;
+  std::uniform_int_distribution<int> dis(0, 2 * n);
+  std::vector<std::vector<int>::iterator> out;
+
+  for (auto m = 1 << 10; m <= 1 << 20; m *= 4) {
+    std::vector<int> queries(m);
+    for (auto& o : queries)
+      o = dis(gen);
+
+    std::cout << m << " "
+      << ns_per_query(queries, [&](int o)
+         { return rt::binary_search(f, l, o); }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return std::lower_bound(f, l, o) - f; }) << " ";
+
+    batch_stats stats;
+    out.clear();
+    lower_bound_many( f, l, std::begin(queries), std::end(queries)
+                    , std::back_inserter(out), &stats);
+    std::cout << stats.time.count() / double(m) << " ";
+
+    auto t = std::chrono::steady_clock::now();
+    std::sort(std::begin(queries), std::end(queries));
+    std::chrono::nanoseconds d = std::chrono::steady_clock::now() - t;
+    out.clear();
+    lower_bound_many( f, l, std::begin(queries), std::end(queries)
+                    , std::back_inserter(out), &stats);
+    std::cout << stats.time.count() / double(m) << " "
+              << d.count() / double(m) << std::endl;
+  }
+}
+
+// Looks up keys that are in 2^e sorted ints drawn from three
+// distributions. Uniform suits interpolation best. Clustered puts the
+// keys in 64 tight groups. Adversarial grows geometrically, so every
+// interpolation probe lands far below the key.
+// exponential_lower_bound starts from a hint within 64 elements of
+// the answer.
+void bench_distributions(int e)
+{
+  std::cout << "# distribution std::lower_bound branchless "
+               "interpolation exponential(hint) (ns per query)"
+            << std::endl;
+
+  auto const n = 1 << e;
+  auto const m = 1000000;
+  auto const max = std::numeric_limits<int>::max();
+  std::mt19937 gen;
+
+  std::vector<int> uniform(n);
+  std::uniform_int_distribution<int> any(0, max - 1);
+  for (auto& o : uniform)
+    o = any(gen);
+
+  std::vector<int> clustered(n);
+  std::uniform_int_distribution<int> near(0, n / 64);
+  for (auto i = 0; i < n; ++i)
+    clustered[i] = (i % 64) * (max / 64) + near(gen);
+
+  std::vector<int> adversarial(n);
+  for (auto i = 0; i < n; ++i)
+    adversarial[i] = i + static_cast<int>(std::pow(2.0, 30.0 * i / n));
+
+  std::pair<const char*, std::vector<int>*> dists[] =
+  { {"uniform", &uniform}
+  , {"clustered", &clustered}
+  , {"adversarial", &adversarial}
+  };
+
+  std::uniform_int_distribution<int> pos(0, n - 1);
+  std::uniform_int_distribution<int> off(-64, 64);
+  std::vector<int> idx(m);
+  std::iota(std::begin(idx), std::end(idx), 0);
+
+  for (auto d : dists) {
+    auto& data = *d.second;
+    std::sort(std::begin(data), std::end(data));
+
+    std::vector<int> queries(m);
+    std::vector<int> hints(m);
+    for (auto i = 0; i < m; ++i) {
+      auto p = pos(gen);
+      queries[i] = data[p];
+      hints[i] = std::min(std::max(p + off(gen), 0), n - 1);
+    }
+
+    auto f = std::begin(data);
+    auto l = std::end(data);
+    std::cout << d.first << " "
+      << ns_per_query(queries, [&](int o)
+         { return std::lower_bound(f, l, o) - f; }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return branchless_lower_bound(f, l, o) - f; }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return interpolation_lower_bound(f, l, o) - f; }) << " "
+      << ns_per_query(idx, [&](int i)
+         { return exponential_lower_bound(f, f + hints[i], l, queries[i])
+                  - f; })
+      << std::endl;
+  }
+}
+
+// Random keys against learned indexes of 2^20 up to 2^e uniform
+// random ints, 2^30 being about 10^9. Also prints the segments and
+// the bytes the eps = 64 model takes.
+void bench_learned(int e)
+{
+  std::cout << "# size binary_search std::lower_bound learned(16) "
+               "learned(64) learned(256) (ns per query) segments bytes"
+            << std::endl;
+
+  auto const m = 1000000;
+  std::mt19937 gen;
+  std::uniform_int_distribution<int> any;
+
+  for (auto k = 20; k <= e; k += 2) {
+    auto n = 1 << k;
+    std::vector<int> data(n);
+    for (auto& o : data)
+      o = any(gen);
+    std::sort(std::begin(data), std::end(data));
+
+    std::vector<int> queries(m);
+    for (auto& o : queries)
+      o = any(gen);
+
+    auto f = data.data();
+    auto l = f + n;
+    std::cout << n << " "
+      << ns_per_query(queries, [&](int o)
+         { return rt::binary_search(f, l, o); }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return std::lower_bound(f, l, o) - f; });
+
+    std::size_t segments = 0;
+    std::size_t bytes = 0;
+    for (auto eps : {16, 64, 256}) {
+      learned_index index(f, l, eps);
+      std::cout << " " << ns_per_query(queries, [&](int o)
+                          { return index.lower_bound(o) - f; });
+      if (eps == 64) {
+        segments = index.segments();
+        bytes = index.bytes();
+      }
+    }
+    std::cout << " " << segments << " " << bytes << std::endl;
+  }
+}
+
+// Rotated ranges of 2^10 up to 2^e ints: binary_search_rotated, which
+// finds the rotation on every call, against a rotated_view built once.
+void bench_rotated(int e)
+{
+  std::cout << "# size binary_search_rotated rotated_view::contains "
+               "rotated_view::lower_bound_many (ns per query)" << std::endl;
+
+  auto const m = 1000000;
+  std::mt19937 gen;
+
+  for (auto k = 10; k <= e; k += 4) {
+    auto n = 1 << k;
+    std::vector<int> data(n);
+    for (auto i = 0; i < n; ++i)
+      data[i] = 2 * i;
+    std::rotate(std::begin(data), std::begin(data) + n / 3, std::end(data));
+
+    std::uniform_int_distribution<int> dis(0, 2 * n);
+    std::vector<int> queries(m);
+    for (auto& o : queries)
+      o = dis(gen);
+
+    auto f = std::begin(data);
+    auto l = std::end(data);
+    auto v = make_rotated_view(f, l);
+    std::cout << n << " "
+      << ns_per_query(queries, [&](int o)
+         { return binary_search_rotated(f, l, o); }) << " "
+      << ns_per_query(queries, [&](int o)
+         { return v.contains(o); }) << " ";
+
+    batch_stats stats;
+    std::vector<decltype(v.begin())> out;
+    v.lower_bound_many( std::begin(queries), std::end(queries)
+                      , std::back_inserter(out), &stats);
+    std::cout << stats.time.count() / double(m) << std::endl;
+  }
+}
+
+// Returns the time in milliseconds f takes.
+template <class F>
+auto ms(F f)
+{
+  auto t = std::chrono::steady_clock::now();
+  auto r = f();
+  std::chrono::duration<double, std::milli> d =
+    std::chrono::steady_clock::now() - t;
+
+  // Keeps the call from being optimized away.
+  if (r == 42)
+    std::cout << " ";
+
+  return d.count();
+}
+
+// Full scans of 2^e unsorted ints. The key searched for is missing,
+// so find reads everything.
+void bench_scan(int e)
+{
+  std::cout << "# threads find parallel_find max_element "
+               "parallel_max_element std::minmax_element minmax_element "
+               "minmax_value(sse2) minmax_value(avx2) (ms)" << std::endl;
+
+  auto const n = std::size_t {1} << e;
+  std::vector<int> data(n);
+  std::mt19937 gen;
+  std::uniform_int_distribution<int> dis(0, 1 << 30);
+  for (auto& o : data)
+    o = dis(gen);
+
+  auto f = data.data();
+  auto l = f + n;
+  auto const k = -1;
+  auto const avx2 = std::min(simd_isa::avx2, simd_best());
+  for (auto t = 1; t <= hardware_threads(); t *= 2) {
+    std::cout << t << " "
+      << ms([&]() { return rt::find(f, l, k) - f; }) << " "
+      << ms([&]() { return parallel_find(f, l, k, t) - f; }) << " "
+      << ms([&]() { return *rt::max_element(f, l); }) << " "
+      << ms([&]() { return *parallel_max_element(f, l, t); }) << " "
+      << ms([&]() { return *std::minmax_element(f, l).first; }) << " "
+      << ms([&]() { return *rt::minmax_element(f, l).first; }) << " "
+      << ms([&]() { return minmax_value(f, l, simd_isa::sse2).first; })
+      << " "
+      << ms([&]() { return minmax_value(f, l, avx2).first; })
+      << std::endl;
+  }
+}
+
+// Set operations between a posting list of 2^e ids and one 1 to 1024
+// times shorter, both drawn from ids below 2^(e + 2). Difference is
+// long minus short.
+void bench_set_ops(int e)
+{
+  std::cout << "# ratio std::set_intersection set_intersection "
+               "std::set_union set_union std::set_difference "
+               "set_difference (ms)" << std::endl;
+
+  auto const n = 1 << e;
+  std::mt19937 gen;
+  std::uniform_int_distribution<int> dis(0, 4 * n);
+  auto make_set = [&](int m)
+  {
+    std::vector<int> v(m);
+    for (auto& o : v)
+      o = dis(gen);
+    std::sort(std::begin(v), std::end(v));
+    v.erase(std::unique(std::begin(v), std::end(v)), std::end(v));
+    return v;
+  };
+
+  auto a = make_set(n);
+  std::vector<int> out(2 * n);
+  for (auto ratio = 1; ratio <= 1024; ratio *= 2) {
+    auto b = make_set(n / ratio);
+    auto f1 = std::cbegin(a);
+    auto l1 = std::cend(a);
+    auto f2 = std::cbegin(b);
+    auto l2 = std::cend(b);
+    auto o = out.data();
+    auto run = [&](auto op) { return ms([&]() { return op() - o; }); };
+
+    std::cout << ratio << " "
+      << run([&]() { return std::set_intersection(f1, l1, f2, l2, o); }) << " "
+      << run([&]() { return rt::set_intersection(f1, l1, f2, l2, o); }) << " "
+      << run([&]() { return std::set_union(f1, l1, f2, l2, o); }) << " "
+      << run([&]() { return rt::set_union(f1, l1, f2, l2, o); }) << " "
+      << run([&]() { return std::set_difference(f1, l1, f2, l2, o); }) << " "
+      << run([&]() { return rt::set_difference(f1, l1, f2, l2, o); })
+      << std::endl;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  std::string b = argc > 1 ? argv[1] : "";
+  auto e = argc > 2 ? std::stoi(argv[2]) : 28;
+
+  if (b.empty() || b == "large")
+    bench_search(e);
+
+  if (b.empty() || b == "small")
+    bench_small();
+
+  if (b.empty() || b == "batch")
+    bench_batch(e);
+
+  if (b.empty() || b == "distributions")
+    bench_distributions(e);
+
+  if (b.empty() || b == "learned")
+    bench_learned(e);
+
+  if (b.empty() || b == "rotated")
+    bench_rotated(e);
+
+  if (b.empty() || b == "scan")
+    bench_scan(e);
+
+  if (b.empty() || b == "set")
+    bench_set_ops(e);
+}
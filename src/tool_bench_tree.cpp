@@ -0,0 +1,487 @@
+#include <string>
+#include <limits>
+#include <thread>
+#include <sstream>
+#include <iostream>
+
+#include "rtcpp.hpp"
+
+using namespace rt;
+
+// Returns the number of keys inserted per millisecond.
+template <class Alloc>
+auto insert_rate(std::vector<int> const& data, Alloc& alloc)
+{
+  bst_node head {};
+  timer t;
+  for (auto o : data)
+    bst_insert(head, o, alloc);
+  auto c = t.get_count();
+  bst_clear(head, alloc);
+  return data.size() / std::max<long long>(1, c);
+}
+
+void bench_insert()
+{
+  std::cout << "# size new pool (keys/ms)" << std::endl;
+
+  auto first = std::numeric_limits<int>::min();
+  auto last = std::numeric_limits<int>::max();
+
+  for (auto size = 10000; size <= 10000000; size *= 10) {
+    auto data = make_rand_data(size, first, last);
+
+    new_alloc<> a1;
+    node_pool<> a2;
+    std::cout << size << " "
+              << insert_rate(data, a1) << " "
+              << insert_rate(data, a2) << std::endl;
+  }
+}
+
+// Returns the time in milliseconds taken by repeat full traversals.
+template <class Successor, class Node>
+auto traversal_time(Node* root, int repeat)
+{
+  using iter = bst_iter<Successor>;
+
+  long long sum = 0;
+  timer t;
+  for (auto i = 0; i < repeat; ++i)
+    sum = std::accumulate(iter {root}, iter {}, sum);
+  auto c = t.get_count();
+
+  // Keeps the loop from being optimized away.
+  if (sum == 42)
+    std::cout << " ";
+
+  return c;
+}
+
+void bench_traversal()
+{
+  std::cout << "# size inorder threaded_inorder "
+               "preorder threaded_preorder (ms)" << std::endl;
+
+  auto first = std::numeric_limits<int>::min();
+  auto last = std::numeric_limits<int>::max();
+
+  for (auto size = 10000; size <= 1000000; size *= 10) {
+    auto data = make_rand_data(size, first, last);
+    auto repeat = 10000000 / size;
+
+    bst t1;
+    threaded_node t2 {};
+    node_pool<threaded_node> pool;
+    for (auto o : data) {
+      t1.insert(o);
+      bst_insert(t2, o, pool);
+    }
+
+    std::cout << size << " "
+      << traversal_time<inorder_successor>(t1.head.left, repeat) << " "
+      << traversal_time<threaded_inorder_successor>(t2.left, repeat) << " "
+      << traversal_time<preorder_successor>(t1.head.left, repeat) << " "
+      << traversal_time<threaded_preorder_successor>(t2.left, repeat)
+      << std::endl;
+  }
+}
+
+// Compares pointer based search with the van Emde Boas layout. The
+// largest tree has 10^e keys.
+void bench_veb(int e)
+{
+  std::cout << "# size bst veb (ms for 10^6 lookups)" << std::endl;
+
+  auto first = std::numeric_limits<int>::min();
+  auto last = std::numeric_limits<int>::max();
+
+  auto const m = 1000000;
+  for (auto size = 10000; size <= std::pow(10, e); size *= 10) {
+    auto data = make_rand_data(size, first, last);
+    auto queries = make_rand_data(m, 0, data.size() - 1, 1);
+    for (auto& o : queries)
+      o = data[o];
+
+    bst t1;
+    for (auto o : data)
+      t1.insert(o);
+    auto t2 = freeze(t1.head.left);
+
+    auto hits = 0;
+    timer t;
+    for (auto o : queries)
+      hits += !!bst_find(t1.head.left, o);
+    auto c1 = t.get_count();
+
+    timer tt;
+    for (auto o : queries)
+      hits += veb_find(t2, o);
+    auto c2 = tt.get_count();
+
+    if (hits != 2 * m)
+      std::cout << "error ";
+
+    std::cout << size << " " << c1 << " " << c2 << std::endl;
+  }
+}
+
+void bench_build()
+{
+  std::cout << "# size insert build build_parallel (ms)" << std::endl;
+
+  auto first = std::numeric_limits<int>::min();
+  auto last = std::numeric_limits<int>::max();
+
+  for (auto size = 10000; size <= 10000000; size *= 10) {
+    auto data = make_rand_data(size, first, last);
+    auto sorted = data;
+    std::sort(std::begin(sorted), std::end(sorted));
+
+    timer t1;
+    bst a;
+    for (auto o : data)
+      a.insert(o);
+    auto c1 = t1.get_count();
+
+    timer t2;
+    node_pool<> p1;
+    bst_build(std::begin(sorted), std::end(sorted), p1);
+    auto c2 = t2.get_count();
+
+    timer t3;
+    node_pool<> p2;
+    bst_build( std::begin(sorted), std::end(sorted), p2
+             , hardware_threads());
+    auto c3 = t3.get_count();
+
+    std::cout << size << " " << c1 << " " << c2 << " " << c3 << std::endl;
+  }
+}
+
+template <int G>
+auto find_many_rate(const bst& t, std::vector<int> const& queries)
+{
+  std::vector<const bst_node*> r(queries.size());
+  timer tt;
+  bst_find_many<G>( t.head.left, std::begin(queries), std::end(queries)
+                  , std::begin(r));
+  auto c = tt.get_count();
+  return queries.size() / std::max<long long>(1, c);
+}
+
+// Lookups per millisecond of bst_find and of bst_find_many with
+// growing batches.
+void bench_batch()
+{
+  std::cout << "# size bst_find G=1 G=2 G=4 G=8 G=16 G=32 (lookups/ms)"
+            << std::endl;
+
+  auto first = std::numeric_limits<int>::min();
+  auto last = std::numeric_limits<int>::max();
+
+  auto const m = 2000000;
+  for (auto size = 10000; size <= 10000000; size *= 10) {
+    auto data = make_rand_data(size, first, last);
+    auto queries = make_rand_data(m, 0, data.size() - 1, 1);
+    for (auto& o : queries)
+      o = data[o];
+
+    bst t;
+    for (auto o : data)
+      t.insert(o);
+
+    auto hits = 0;
+    timer tt;
+    for (auto o : queries)
+      hits += !!bst_find(t.head.left, o);
+    auto c = tt.get_count();
+
+    if (hits != m)
+      std::cout << "error ";
+
+    std::cout << size << " "
+              << m / std::max<long long>(1, c) << " "
+              << find_many_rate<1>(t, queries) << " "
+              << find_many_rate<2>(t, queries) << " "
+              << find_many_rate<4>(t, queries) << " "
+              << find_many_rate<8>(t, queries) << " "
+              << find_many_rate<16>(t, queries) << " "
+              << find_many_rate<32>(t, queries) << std::endl;
+  }
+}
+
+// Insertion and lookup times of the binary tree and of B+-trees with
+// one and two cache lines of keys per node. The largest tree has 10^e
+// keys.
+template <int B>
+void btree_times(std::vector<int> const& data, std::vector<int> const& q)
+{
+  timer t1;
+  btree<B> t;
+  for (auto o : data)
+    t.insert(o);
+  auto c1 = t1.get_count();
+
+  auto hits = 0;
+  timer t2;
+  for (auto o : q)
+    hits += t.find(o) != t.end();
+  auto c2 = t2.get_count();
+
+  if (hits != static_cast<int>(q.size()))
+    std::cout << "error ";
+
+  std::cout << c1 << " " << c2 << " " << t.bytes() / data.size() << " ";
+}
+
+void bench_btree(int e)
+{
+  std::cout << "# size bst(insert find bytes/key) btree<16>(...) "
+               "btree<32>(...) (ms for 10^6 lookups)" << std::endl;
+
+  auto first = std::numeric_limits<int>::min();
+  auto last = std::numeric_limits<int>::max();
+
+  auto const m = 1000000;
+  for (auto size = 10000; size <= std::pow(10, e); size *= 10) {
+    auto data = make_rand_data(size, first, last);
+    auto queries = make_rand_data(m, 0, data.size() - 1, 1);
+    for (auto& o : queries)
+      o = data[o];
+
+    timer t1;
+    bst t;
+    for (auto o : data)
+      t.insert(o);
+    auto c1 = t1.get_count();
+
+    auto hits = 0;
+    timer t2;
+    for (auto o : queries)
+      hits += !!bst_find(t.head.left, o);
+    auto c2 = t2.get_count();
+
+    if (hits != m)
+      std::cout << "error ";
+
+    std::cout << size << " " << c1 << " " << c2 << " "
+              << sizeof (bst_node) << " ";
+    btree_times<16>(data, queries);
+    btree_times<32>(data, queries);
+    std::cout << std::endl;
+  }
+}
+
+// Number of comparisons bst_find makes to find key.
+auto search_depth(const bst_node* p, int key)
+{
+  auto d = 1;
+  for (; p->info != key; ++d)
+    p = key < p->info ? p->left : p->right;
+  return d;
+}
+
+// Zipf distributed lookups with exponent s in a static tree and in a
+// splayed one, on trees of up to 10^e keys. The hot keys are spread at
+// random over the key range.
+void bench_splay(int e, double s)
+{
+  std::cout << "# size static(depth ms) splay(depth ms) "
+               "(10^6 lookups, s = " << s << ")" << std::endl;
+
+  auto first = std::numeric_limits<int>::min();
+  auto last = std::numeric_limits<int>::max();
+
+  auto const m = 1000000;
+  for (auto size = 10000; size <= std::pow(10, e); size *= 10) {
+    // The hot keys must not be the first ones inserted, as those are
+    // near the root anyway.
+    auto data = make_rand_data(size, first, last);
+    auto hot = data;
+    std::shuffle(std::begin(hot), std::end(hot), std::mt19937 {});
+    auto queries = make_zipf_data(m, data.size(), s);
+    for (auto& o : queries)
+      o = hot[o];
+
+    bst t1;
+    bst t2;
+    bst t3;
+    for (auto o : data) {
+      t1.insert(o);
+      t2.insert(o);
+      t3.insert(o);
+    }
+
+    long long d1 = 0;
+    long long d2 = 0;
+    for (auto o : queries) {
+      d1 += search_depth(t1.head.left, o);
+      d2 += search_depth(t2.head.left, o);
+      bst_splay_find(t2.head, o);
+    }
+
+    auto hits = 0;
+    timer tt1;
+    for (auto o : queries)
+      hits += !!bst_find(t1.head.left, o);
+    auto c1 = tt1.get_count();
+
+    timer tt2;
+    for (auto o : queries)
+      hits += !!bst_splay_find(t3.head, o);
+    auto c2 = tt2.get_count();
+
+    if (hits != 2 * m)
+      std::cout << "error ";
+
+    std::cout << size << " "
+              << double(d1) / m << " " << c1 << " "
+              << double(d2) / m << " " << c2 << std::endl;
+  }
+}
+
+// Startup by rebuilding a tree with bst_insert against opening its
+// serialized form, and lookups in both.
+void bench_flat(int e)
+{
+  std::cout << "# size rebuild serialize open (ms) bst flat "
+               "(ms for 10^6 lookups)" << std::endl;
+
+  auto first = std::numeric_limits<int>::min();
+  auto last = std::numeric_limits<int>::max();
+
+  auto const m = 1000000;
+  for (auto size = 10000; size <= std::pow(10, e); size *= 10) {
+    auto data = make_rand_data(size, first, last);
+    auto queries = make_rand_data(m, 0, data.size() - 1, 1);
+    for (auto& o : queries)
+      o = data[o];
+
+    timer t1;
+    bst t;
+    for (auto o : data)
+      t.insert(o);
+    auto c1 = t1.get_count();
+
+    timer t2;
+    std::ostringstream os;
+    bst_serialize(t.head.left, os);
+    auto buf = os.str();
+    auto c2 = t2.get_count();
+
+    timer t3;
+    bst_view v(buf.data(), buf.size());
+    auto c3 = t3.get_count();
+
+    auto hits = 0;
+    timer t4;
+    for (auto o : queries)
+      hits += !!bst_find(t.head.left, o);
+    auto c4 = t4.get_count();
+
+    timer t5;
+    for (auto o : queries)
+      hits += !!v.find(o);
+    auto c5 = t5.get_count();
+
+    if (hits != 2 * m)
+      std::cout << "error ";
+
+    std::cout << size << " " << c1 << " " << c2 << " " << c3 << " "
+              << c4 << " " << c5 << std::endl;
+  }
+}
+
+// Lookup throughput of concurrent_bst with 1 to all cores reading
+// while one more thread inserts. Readers pin a version every 64
+// lookups.
+void bench_concurrent()
+{
+  std::cout << "# readers lookups/ms inserts/ms" << std::endl;
+
+  auto first = std::numeric_limits<int>::min();
+  auto last = std::numeric_limits<int>::max();
+
+  auto const size = 1000000;
+  auto const ms = 500;
+  auto data = make_rand_data(2 * size, first, last);
+  auto threads = hardware_threads();
+
+  for (auto r = 1; r <= threads; ++r) {
+    concurrent_bst t(r);
+    for (auto i = 0; i < size; ++i)
+      t.insert(data[i]);
+
+    std::atomic<bool> done {false};
+    std::atomic<long long> lookups {0};
+    auto read = [&](int id)
+    {
+      std::mt19937 gen(id);
+      std::uniform_int_distribution<int> dis(0, 2 * size - 1);
+      long long n = 0;
+      auto hits = 0;
+      while (!done) {
+        concurrent_bst::snapshot s(t, id);
+        for (auto i = 0; i < 64; ++i)
+          hits += s.contains(data[dis(gen)]);
+        n += 64;
+      }
+      lookups += n + (hits < 0);
+    };
+
+    std::vector<std::thread> pool;
+    for (auto i = 0; i < r; ++i)
+      pool.emplace_back(read, i);
+
+    timer tt;
+    auto i = size;
+    while (tt.get_count() < ms && i < 2 * size)
+      t.insert(data[i++]);
+    while (tt.get_count() < ms)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    done = true;
+    for (auto& o : pool)
+      o.join();
+
+    auto c = std::max<long long>(1, tt.get_count());
+    std::cout << r << " " << lookups / c << " " << (i - size) / c
+              << std::endl;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  std::string b = argc > 1 ? argv[1] : "";
+  auto e = argc > 2 ? std::stoi(argv[2]) : 7;
+  // Zipf exponent for splay.
+  auto s = argc > 3 ? std::stod(argv[3]) : 1.0;
+
+  if (b.empty() || b == "insert")
+    bench_insert();
+
+  if (b.empty() || b == "traversal")
+    bench_traversal();
+
+  if (b.empty() || b == "veb")
+    bench_veb(e);
+
+  if (b.empty() || b == "build")
+    bench_build();
+
+  if (b.empty() || b == "batch")
+    bench_batch();
+
+  if (b.empty() || b == "btree")
+    bench_btree(e);
+
+  if (b.empty() || b == "splay")
+    bench_splay(e, s);
+
+  if (b.empty() || b == "flat")
+    bench_flat(e);
+
+  if (b.empty() || b == "concurrent")
+    bench_concurrent();
+}